@@ -2,7 +2,7 @@
 
 Demonstrate use of Helix library, embedded in to a file-based command-line cryptographic utility.
 Usage: 
-`helix_c99_demo.exe [-h] [-ed] [-s string] [--port=<n>] -u string -i string [-o string] [-p string]`
+`helix_c99_demo.exe [-h] [-ed] [-s string] [--port=<n>] -u string [-i string] [-l string] [-r string] [-j <n>] [--max-inflight-mb=<n>] [-o string] [-p string] [--log-level=level]`
 
   -h, --help                display this help and exit
   -s, --server=string       ip/DNS name of key server, without protocol (optional, if licensed)
@@ -11,8 +11,13 @@ Usage:
   -e, --encrypt             encrypt the contents of the input file
   -d, --decrypt             decrypt the contents of the input file or of the result of the encryption (is encryption is done as well)
   -i, --input=string        filepath of input file; file could be either plaintext or already encrypted (for decryption step)
+  -l, --list=string         filepath of a text file listing one input filepath per line (batch mode)
+  -r, --recursive=string    directory to walk recursively, processing every regular file found in it (batch mode)
+  -j, --jobs=<n>            number of files processed concurrently in batch mode (default 4, POSIX only)
+  --max-inflight-mb=<n>     memory budget in MiB for file data held until outputs are written in batch mode (default 0: unlimited)
   -o, --output=string       start of filename for the output file - if omitted, input filename will be used; all output files will have a '-(en/de)crypted' postfix appended
   -p, --password=string     password to use for encryption/decryption (optional)
+  --log-level=level         utility's own output: none, error, warn, info, debug or all (default); per-operation Helix call tracing is logged at debug level
 
 
 Server and port arguments are optional, if distributed by BlakFx along with the utility.
@@ -27,8 +32,17 @@ For example, encrypted output of `my_text.txt` will be saved as `my_text.txt-enc
 Generated files with decrypted contents will have "-decrypted" appended to the original filename.
 For example, decrypted output of `my_text.txt` will be saved as `my_text.txt-decrypted`.
 
+Exactly one of `-i`, `-l` or `-r` must be given. In batch mode (`-l` or `-r`) all files are processed
+inside a single Helix module session by a bounded pool of worker threads, and output files are written
+next to their inputs. When walking a directory, encryption skips files that already carry a
+'-encrypted' or '-decrypted' postfix, and decryption alone only picks up '-encrypted' files.
+
 */
 
+#if defined (__unix__) && !defined (_POSIX_C_SOURCE)
+#	define _POSIX_C_SOURCE 200809L	// clock_gettime, lstat
+#endif
+
 #include "helix_crypto.h"
 #include "argtable3.h"
 
@@ -37,9 +51,14 @@ For example, decrypted output of `my_text.txt` will be saved as `my_text.txt-dec
 #include <inttypes.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <time.h>
 
 #if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
 #	include <unistd.h>
+#	include <pthread.h>
+#	include <dirent.h>
+#	include <sys/stat.h>
+#	define HELIX_DEMO_POSIX 1
 #endif
 
 
@@ -62,15 +81,145 @@ For example, decrypted output of `my_text.txt` will be saved as `my_text.txt-dec
 #define ERROR_HELIX_DECRYPT_SIZE 16
 #define ERROR_HELIX_ACCOUNT 17
 #define ERROR_ARGPARSE_INVALID 18
+#define ERROR_BATCH_INPUT 19
+#define ERROR_BATCH_FAILED 20
+
+#define MAX_FILEPATH_LENGTH 2048
+#define DEFAULT_BATCH_JOBS 4
+#define MAX_BATCH_JOBS 256
+
+#if defined (HELIX_DEMO_POSIX)
+#	define BATCH_LOCK(job) pthread_mutex_lock(&(job)->lock)
+#	define BATCH_UNLOCK(job) pthread_mutex_unlock(&(job)->lock)
+#	define BATCH_WAIT(job) pthread_cond_wait(&(job)->budgetFreed, &(job)->lock)
+#	define BATCH_SIGNAL(job) pthread_cond_broadcast(&(job)->budgetFreed)
+#else
+#	define BATCH_LOCK(job) ((void)(job))
+#	define BATCH_UNLOCK(job) ((void)(job))
+#	define BATCH_WAIT(job) ((void)(job))
+#	define BATCH_SIGNAL(job) ((void)(job))
+#endif
+
+/**
+	\brief Severity ranks of the utility's own messages; each rank also enables all more severe ones.
+	These filter the demo's output only - logging inside the Helix module is not affected.
+*/
+typedef enum __demoLogRank_t {
+	DEMO_LOG_NONE = 0,		///< nothing, not even the error printed before a fatal exit
+	DEMO_LOG_ERROR = 1,
+	DEMO_LOG_WARN = 2,
+	DEMO_LOG_INFO = 3,
+	DEMO_LOG_DEBUG = 4,		///< includes per-operation Helix call tracing
+} demoLogRank_t;
+
+/**
+	\brief Active rank of the utility, set with --log-level.
+	A message is emitted when its rank does not exceed the active one; a disabled level costs a single branch,
+	and its arguments are not evaluated.
+*/
+demoLogRank_t demoLogRank = DEMO_LOG_DEBUG;
+
+#define LOG_AT(rank, stream, ...) do { \
+		if((rank) <= demoLogRank) { fprintf((stream), __VA_ARGS__); } \
+	} while(0)
+#define LOG_ERROR(...) LOG_AT(DEMO_LOG_ERROR, stderr, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(DEMO_LOG_WARN, stderr, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(DEMO_LOG_INFO, stdout, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(DEMO_LOG_DEBUG, stdout, __VA_ARGS__)
+
+/**
+	\brief Single batch input file, sized when the batch is collected.
+*/
+typedef struct __batchInput_t {
+	char *path;			///< input file path, owned by the batch job
+	uint64_t bytes;			///< size of the file when it was collected
+} batchInput_t;
+
+/**
+	\brief Result of claiming the next batch input against the in-flight memory budget.
+*/
+typedef enum __batchClaim_t {
+	BATCH_CLAIM_NONE = 0,		///< no inputs left to process
+	BATCH_CLAIM_OK = 1,		///< input claimed and its memory reserved
+	BATCH_CLAIM_BUSY = 2,		///< in-flight budget exhausted; input left for later (non-blocking claims only)
+} batchClaim_t;
+
+/**
+	\brief Set of input files processed in batch mode, with the settings and counters shared by all workers.
+*/
+typedef struct __batchJob_t {
+	batchInput_t *inputs;		///< input files, owned by the job
+	size_t count;			///< number of entries in inputs
+	size_t capacity;		///< allocated entries in inputs
+	size_t next;			///< index of the next input to hand out to a worker
+	uint64_t maxInFlightBytes;	///< memory budget for inputs and outputs held at once (0: unlimited)
+	uint64_t inFlightBytes;		///< memory currently reserved by claimed inputs
+	size_t claimsDeferred;		///< read-aheads deferred because the budget was exhausted
+	bool encrypt;			///< encrypt every input file
+	bool decrypt;			///< decrypt every input file (or its encrypted output, when encrypting as well)
+	PROMISE_ID recipientID;		///< recipient looked up once for all encryptions
+	const char *password;		///< optional password used for every file
+	size_t filesDone;		///< files processed without error
+	size_t filesFailed;		///< files that failed at any step
+	uint64_t bytesIn;		///< bytes read from input files
+	uint64_t bytesOut;		///< bytes written to output files
+#if defined (HELIX_DEMO_POSIX)
+	pthread_mutex_t lock;		///< guards next, inFlightBytes and the counters above
+	pthread_cond_t budgetFreed;	///< signalled whenever reserved memory is returned to the budget
+#endif
+} batchJob_t;
+
+/**
+	\brief One batch input moving through a pipelined worker: read from disk, in flight inside Helix, then written out.
+*/
+typedef struct __batchStage_t {
+	const char *path;		///< input file path (owned by the batch job)
+	uint64_t reserved;		///< memory reserved from the in-flight budget for this input
+	uint8_t *input;			///< input file contents, owned by the stage
+	size_t inputBytes;		///< size of input
+	PROMISE_ID handle;		///< Helix encryption or decryption handle, once submitted
+	bool submitted;			///< whether handle refers to a submitted Helix operation
+	uint8_t *output;		///< Helix-owned result, valid until handle is released
+	size_t outputBytes;		///< size of output
+	int error;			///< ERROR_NONE, or the first ERROR_* code hit by this input
+} batchStage_t;
 
 // Forward declarations
 void loadHelixModule(const char *, uint16_t, const char *, const char *);
 invokeStatus_t connectToHelixKeyServer(void);
 int authenticateWithHelixNetwork(const char*);
 uint8_t * readBytesFromFile(const char *path, size_t *bytesRead);
+uint8_t * loadBytesFromFile(const char *path, size_t *bytesRead, int *error);
+PROMISE_ID findRecipient(const char *recipientAccount);
 uint8_t * encryptFromBytes(const char *, uint8_t *content, size_t len, const char *password, size_t *outBytes);
+uint8_t * encryptForRecipient(PROMISE_ID recipientID, uint8_t *content, size_t len, const char *password, size_t *outBytes, ENCRYPT_ID *handle);
 uint8_t * decryptFromBytes(uint8_t *blob, size_t len, const char *password, size_t *outBytes);
+uint8_t * decryptToBytes(uint8_t *blob, size_t len, const char *password, size_t *outBytes, DECRYPT_ID *handle);
+ENCRYPT_ID beginEncryption(PROMISE_ID recipientID, uint8_t *content, size_t len, const char *password);
+uint8_t * completeEncryption(ENCRYPT_ID encryptionHandle, size_t *outBytes);
+DECRYPT_ID beginDecryption(uint8_t *blob, size_t len, const char *password);
+uint8_t * completeDecryption(DECRYPT_ID decryptionHandle, size_t *outBytes);
 void writeBytesToFile(const char *path, const uint8_t *content, size_t count);
+int storeBytesToFile(const char *path, const uint8_t *content, size_t count);
+int collectFilesFromList(batchJob_t *job, const char *listPath);
+int collectFilesFromDirectory(batchJob_t *job, const char *dirPath);
+int batchAddPath(batchJob_t *job, const char *path, uint64_t bytes);
+uint64_t fileSizeOf(const char *path);
+batchClaim_t batchClaimInput(batchJob_t *job, bool wait, const char **path, uint64_t *reserved);
+void batchReleaseBudget(batchJob_t *job, uint64_t reserved);
+bool batchAcceptsPath(const batchJob_t *job, const char *path);
+int processBatchFile(batchJob_t *job, const char *path, uint64_t reserved, uint64_t *bytesIn, uint64_t *bytesOut);
+void * batchWorker(void *context);
+void * batchPipelineWorker(void *context);
+void batchAccount(batchJob_t *job, const char *path, int error, uint64_t bytesIn, uint64_t bytesOut);
+batchClaim_t batchReadStage(batchJob_t *job, batchStage_t *stage, bool wait);
+void batchSubmitStage(batchJob_t *job, batchStage_t *stage);
+void batchCompleteStage(batchJob_t *job, batchStage_t *stage);
+void batchWriteStage(batchJob_t *job, batchStage_t *stage);
+int runBatch(batchJob_t *job, unsigned jobs);
+void releaseBatch(batchJob_t *job);
+double monotonicSeconds(void);
+bool parseLogLevel(const char *name, demoLogRank_t *rank);
 void disconnectFromHelixKeyServer(void);
 void unloadHelixModule(void);
 
@@ -78,7 +227,8 @@ void unloadHelixModule(void);
 // Main
 struct arg_lit *help = NULL, *enc = NULL, *dec = NULL;
 struct arg_str *in = NULL, *out = NULL, *pass = NULL, *user = NULL, *key_server = NULL, *simulated_id = NULL;
-struct arg_int *key_server_port = NULL;
+struct arg_str *list = NULL, *dir = NULL, *log_level = NULL;
+struct arg_int *key_server_port = NULL, *jobs = NULL, *max_inflight = NULL;
 struct arg_end *end = NULL;
 
 const char DEFAULT_KEY_SERVER[128] = "service.blakfx.us";
@@ -98,14 +248,21 @@ int main(int argc, char **argv) {
 		simulated_id	= arg_strn("f", "simulated", "string", 0, 1, "simulated device id to simulate when running the app"),
 		enc     = arg_litn("e", "encrypt", 0, 1, "encrypt the contents of the input file"),
 		dec     = arg_litn("d", "decrypt", 0, 1, "decrypt the contents of the input file or of the result of the encryption (is encryption is done as well)"),
-		in      = arg_strn("i", "input", "string", 1, 1, "input file, can be either plaintext or already encrypted"),
+		in      = arg_strn("i", "input", "string", 0, 1, "input file, can be either plaintext or already encrypted"),
+		list    = arg_strn("l", "list", "string", 0, 1, "text file listing one input file per line (batch mode)"),
+		dir     = arg_strn("r", "recursive", "string", 0, 1, "directory to walk recursively for input files (batch mode)"),
+		jobs    = arg_intn("j", "jobs", "<n>", 0, 1, "number of files processed concurrently in batch mode"),
+		max_inflight = arg_intn(NULL, "max-inflight-mb", "<n>", 0, 1, "memory budget in MiB for file data held until outputs are written in batch mode (0: unlimited)"),
 		out     = arg_strn("o", "output", "string", 0, 1, "output base filename - if omitted, it's the same as input but on cwd; in any case, output files will have a \'-(en/de)crypted\' postfix accordingly"),
 		pass    = arg_strn("p", "password", "string", 0, 1, "password to use for encryption/decryption"),
+		log_level = arg_strn(NULL, "log-level", "level", 0, 1, "utility's own output: none, error, warn, info, debug or all (default); Helix internal logging is unaffected"),
 		end     = arg_end(20),
 	};
 	//set default values
 	*(key_server->sval) = DEFAULT_KEY_SERVER;
 	*(key_server_port->ival) = DEFAULT_KEY_SERVER_PORT;
+	*(jobs->ival) = DEFAULT_BATCH_JOBS;
+	*(max_inflight->ival) = 0;
 
 	int nErrors = 0;
 	nErrors = arg_parse(argc,argv,argTable);
@@ -134,6 +291,45 @@ int main(int argc, char **argv) {
 	assert(key_server != NULL); assert(key_server_port != NULL);
 	assert(enc != NULL); assert(dec != NULL); assert(user != NULL);
 	assert(in != NULL); assert(out != NULL); assert(pass != NULL);
+	assert(list != NULL); assert(dir != NULL); assert(jobs != NULL); assert(max_inflight != NULL);
+	assert(log_level != NULL);
+
+	if( log_level->count && !parseLogLevel(*(log_level->sval), &demoLogRank) ) {
+		fprintf(stderr, "Error: unknown --log-level \'%s\', expected none, error, warn, info, debug or all\n", *(log_level->sval));
+		arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
+		exit(ERROR_ARGPARSE_INVALID);
+	}
+
+	// Exactly one input source: a single file, a file list, or a directory
+	const bool batch = (list->count + dir->count) > 0;
+	if( (in->count + list->count + dir->count) != 1 || (batch && out->count) ) {
+		fprintf(stderr, "Error: exactly one of --input, --list or --recursive is required; --output applies to --input only\n");
+		printf("Try '%s --help' for more information.\n", argv[0]);
+		arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
+		exit(ERROR_ARGPARSE_INVALID);
+	}
+	if( *(jobs->ival) < 1 || *(jobs->ival) > MAX_BATCH_JOBS ) {
+		fprintf(stderr, "Error: --jobs must be between 1 and %d\n", MAX_BATCH_JOBS);
+		arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
+		exit(ERROR_ARGPARSE_INVALID);
+	}
+#if !defined (HELIX_DEMO_POSIX)
+	if( jobs->count && *(jobs->ival) > 1 ) {
+		fprintf(stderr, "Error: --jobs above 1 needs POSIX threads, batch files are processed one at a time on this platform\n");
+		arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
+		exit(ERROR_ARGPARSE_INVALID);
+	}
+#endif
+	if( *(max_inflight->ival) < 0 ) {
+		fprintf(stderr, "Error: --max-inflight-mb can not be negative\n");
+		arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
+		exit(ERROR_ARGPARSE_INVALID);
+	}
+	if( batch && !enc->count && !dec->count ) {
+		fprintf(stderr, "Error: --list and --recursive need --encrypt, --decrypt or both\n");
+		arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
+		exit(ERROR_ARGPARSE_INVALID);
+	}
 
 	const char *server_ip = *(key_server->sval);
 	const uint16_t server_port = (uint16_t) *(key_server_port->ival);
@@ -148,7 +344,7 @@ int main(int argc, char **argv) {
 	// connect to Helix key-server
 	const invokeStatus_t serverConnectionStatus = connectToHelixKeyServer();
 	if( INVOKE_STATUS_TRUE != serverConnectionStatus) {
-		fprintf(stderr, "Error: helix_serverConnect returned exit code: %d\n", serverConnectionStatus);	
+		LOG_ERROR("Error: helix_serverConnect returned exit code: %d\n", serverConnectionStatus);	
 		return ERROR_HELIX_SERVER;
 	}
 
@@ -156,7 +352,7 @@ int main(int argc, char **argv) {
 	// login to Helix key-server
 	int modulePrepStatus = authenticateWithHelixNetwork(username);
 	if( 0 != modulePrepStatus) {
-		fprintf(stderr, "Error: authenticateWithHelixNetwork returned exit code: %d\n", modulePrepStatus);
+		LOG_ERROR("Error: authenticateWithHelixNetwork returned exit code: %d\n", modulePrepStatus);
 		return -1;
 	}
 
@@ -164,6 +360,35 @@ int main(int argc, char **argv) {
 	// Parsed args successfully, store them into easy-to-access variables
 	bool encrypt = enc->count > 0;
 	bool decrypt = dec->count > 0;
+
+	// Batch mode: many files processed concurrently within this one module session
+	if(batch) {
+		batchJob_t job;
+		memset(&job, 0, sizeof(job));
+		job.encrypt = encrypt;
+		job.decrypt = decrypt;
+		job.password = (pass->count) ? *(pass->sval) : NULL;
+		job.maxInFlightBytes = (uint64_t) *(max_inflight->ival) * 1024 * 1024;
+
+		const int collectStatus = (list->count) ? collectFilesFromList(&job, *(list->sval)) 
+							: collectFilesFromDirectory(&job, *(dir->sval));
+		int batchStatus = collectStatus;
+		if(ERROR_NONE == collectStatus) {
+			// Recipient (oneself) is looked up once and shared by every encryption in the batch
+			job.recipientID = (encrypt && job.count > 0) ? findRecipient(username) : 0;
+			batchStatus = runBatch(&job, (unsigned) *(jobs->ival));
+		}
+		releaseBatch(&job);
+
+		LOG_INFO("Info: main: Disconnecting from the server\n");
+		disconnectFromHelixKeyServer();
+		LOG_INFO("Info: main: Starting shutdown\n");
+		unloadHelixModule();
+		LOG_INFO("Info: main: Finished shutdown\n");
+		arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
+		return batchStatus;
+	}
+
 	const char *inFile = *(in->sval);
 #if defined(_WINDOWS_)
 	char *fileBase = strrchr(inFile, '\\'); // Account for windows path separators
@@ -175,7 +400,6 @@ int main(int argc, char **argv) {
 	const char *password = (pass->count) ? *(pass->sval) : NULL;
 
 	// Prepare encrypted and decrypted paths
-	#define MAX_FILEPATH_LENGTH 2048
 	char outFileEncrypted[MAX_FILEPATH_LENGTH] = { 0 };	// C does not allow compile-time variables as sizes of stack array declarations 
 	char outFileDecrypted[MAX_FILEPATH_LENGTH] = { 0 };
 	strcpy(outFileEncrypted, outFile);
@@ -186,7 +410,7 @@ int main(int argc, char **argv) {
 	// Read the byte contents of a given file
 	size_t bytesFromFile = 0;
 	uint8_t *dataFromFile = readBytesFromFile(inFile, &bytesFromFile);
-	fprintf(stdout, "Info: Read data from file (%zu bytes) from input file \'%s\'\n", bytesFromFile, inFile);
+	LOG_INFO("Info: Read data from file (%zu bytes) from input file \'%s\'\n", bytesFromFile, inFile);
 	
 
 	//track exit status across encrypt/decrypt operations
@@ -197,12 +421,18 @@ int main(int argc, char **argv) {
 	// This allows a user to pass an encrypted file and decrypt it with minor adjustments
 	size_t encryptedBytes = 0;
 	uint8_t *encrypted = NULL;
+	DECRYPT_ID roundTripHandle = 0;
 	if(encrypt) {
 		// sending the message to ourselves now
 		encrypted = encryptFromBytes(username, dataFromFile, bytesFromFile, password, &encryptedBytes);
+		if(decrypt) {
+			// Helix decrypts the result in the background while the encrypted file is being written
+			LOG_DEBUG("Debug: main: Calling decrypt on %zu bytes in memory buffer at %p after encryption is done\n", encryptedBytes, encrypted);
+			roundTripHandle = beginDecryption(encrypted, encryptedBytes, password);
+		}
 		writeBytesToFile(outFileEncrypted, encrypted, encryptedBytes);
 		op_failure |= 0;
-		fprintf(stdout, "Info: wrote %zu bytes to \'%s\'\n", encryptedBytes, outFileEncrypted);
+		LOG_INFO("Info: wrote %zu bytes to \'%s\'\n", encryptedBytes, outFileEncrypted);
 	}
 
 	// Decrypt plaindata/content and write it out
@@ -210,22 +440,24 @@ int main(int argc, char **argv) {
 	uint8_t *decrypted = NULL;
 	if(!op_failure && decrypt) {		
 		if(!encrypt) {
-			fprintf(stdout, "Info: main: Calling decrypt on %zu bytes read from encrypted file: \'%s\' into buffer at %p\n", bytesFromFile, inFile, dataFromFile);
+			LOG_DEBUG("Debug: main: Calling decrypt on %zu bytes read from encrypted file: \'%s\' into buffer at %p\n", bytesFromFile, inFile, dataFromFile);
 			decrypted = decryptFromBytes(dataFromFile, bytesFromFile, password, &decryptedBytes);
 		} else {
-			fprintf(stdout, "Info: main: Calling decrypt on %zu bytes in memory buffer at %p after encryption is done\n", encryptedBytes, encrypted);
-			decrypted = decryptFromBytes(encrypted, encryptedBytes, password, &decryptedBytes);
+			decrypted = completeDecryption(roundTripHandle, &decryptedBytes);
+			if(!decrypted) {
+				exit(ERROR_HELIX_DECRYPT_STATUS);
+			}
 			// Ensure bytes decrypted count == bytes original count
 			if(decryptedBytes != bytesFromFile) {
-				fprintf(stderr, "Error: main: byte count between original plaindata (%zu) and decrypted plaindata (%zu) differs\n", encryptedBytes, decryptedBytes);
+				LOG_ERROR("Error: main: byte count between original plaindata (%zu) and decrypted plaindata (%zu) differs\n", bytesFromFile, decryptedBytes);
 				op_failure |= ERROR_HELIX_DECRYPT_SIZE;
 			}
 		}
 		// Write out
-		fputs("Info: decryption succeeded\n", stdout);
+		LOG_INFO("Info: decryption succeeded\n");
 		writeBytesToFile(outFileDecrypted, decrypted, decryptedBytes);
 		op_failure |= 0;
-		fprintf(stdout, "Info: wrote %zu bytes to \'%s\'\n", decryptedBytes, outFileDecrypted);
+		LOG_INFO("Info: wrote %zu bytes to \'%s\'\n", decryptedBytes, outFileDecrypted);
 	}
 
 	// Note: If these buffers were created with use ot "USER_OWNS_MEMORY" flag, they should be freed here.
@@ -236,29 +468,45 @@ int main(int argc, char **argv) {
 	
 	free(dataFromFile); //THIS buffer is owned by the user
 
-	fprintf(stdout, "Info: main: Disconnecting from the server\n");
+	LOG_INFO("Info: main: Disconnecting from the server\n");
 	disconnectFromHelixKeyServer();
 	
-	fprintf(stdout, "Info: main: Starting shutdown\n");
+	LOG_INFO("Info: main: Starting shutdown\n");
 	unloadHelixModule();
 	
-	fprintf(stdout, "Info: main: Finished shutdown\n");
+	LOG_INFO("Info: main: Finished shutdown\n");
 	arg_freetable(argTable, sizeof(argTable) / sizeof(argTable[0]));
 	
 	return op_failure;
 }
 
 /**
-	\brief Reads bytes from a given file
+	\brief Reads bytes from a given file, exiting the process on failure
 	@param[in] path the path of the file to read
 	@param[out] bytesRead the number of bytes read
 	\return the bytes read
 */
 uint8_t * readBytesFromFile(const char *path, size_t *bytesRead) {
+	int error = ERROR_NONE;
+	uint8_t *buf = loadBytesFromFile(path, bytesRead, &error);
+	if(!buf) {
+		exit(error);
+	}
+	return buf;
+}
+
+/**
+	\brief Reads bytes from a given file, reporting failure to the caller
+	@param[in] path the path of the file to read
+	@param[out] bytesRead the number of bytes read
+	@param[out] error ERROR_NONE on success, otherwise one of the ERROR_INPUT_* codes
+	\return the bytes read (owned by the caller), or NULL on failure
+*/
+uint8_t * loadBytesFromFile(const char *path, size_t *bytesRead, int *error) {
 	size_t expectedBytesFromDisk = 0;
 	uint8_t *buf = NULL;
-	int error = 0;
 	*bytesRead = 0;
+	*error = ERROR_NONE;
 	
 	// Open the file pointed to by path
 	FILE *file = fopen(path, "rb");
@@ -273,8 +521,10 @@ uint8_t * readBytesFromFile(const char *path, size_t *bytesRead) {
 		size_t numofElementsOnDisk = expectedBytesFromDisk * sizeof(uint8_t); // sizeof(uint8_t) is 1
 		buf = (uint8_t *)calloc(numofElementsOnDisk, sizeof(uint8_t));
 		if(!buf) {
-			fprintf(stderr, "Error: could not allocate memory for input file \'%s\'\n", path);
-			exit(ERROR_INPUT_MALLOC);
+			LOG_ERROR("Error: could not allocate memory for input file \'%s\'\n", path);
+			fclose(file);
+			*error = ERROR_INPUT_MALLOC;
+			return NULL;
 		}
 
 		// Read bytes from the file to buffer
@@ -282,50 +532,64 @@ uint8_t * readBytesFromFile(const char *path, size_t *bytesRead) {
 		
 		const size_t bytesReadFromDisk = numOfElementsReadFromDisk * sizeof(uint8_t);
 		if(bytesReadFromDisk != expectedBytesFromDisk) {
-			fprintf(stderr, "Error: expected %zu bytes but read %zu bytes from input\n", expectedBytesFromDisk, bytesReadFromDisk);
-			exit(ERROR_INPUT_READ);
+			LOG_ERROR("Error: expected %zu bytes but read %zu bytes from input\n", expectedBytesFromDisk, bytesReadFromDisk);
+			*error = ERROR_INPUT_READ;
 		}
-		
-		error = ferror(file);
-		if(error) {
-			fprintf(stderr, "Error: could not read from input file \'%s\' - error %d\n", path, error);
-			exit(ERROR_INPUT_READ);
+		else if(ferror(file)) {
+			LOG_ERROR("Error: could not read from input file \'%s\' - error %d\n", path, ferror(file));
+			*error = ERROR_INPUT_READ;
 		}
-		
-		// Success: close file pointer, assign read bytes, and return buffer
 		fclose(file);
+		if(ERROR_NONE != *error) {
+			free(buf);
+			return NULL;
+		}
+		
+		// Success: assign read bytes, and return buffer
 		*bytesRead = bytesReadFromDisk;
 		return buf;
 	}
 	// Could not open file
-	fprintf(stderr, "Error: bad input file name \'%s\'\n", path);
-	exit(ERROR_INPUT_NAME);
+	LOG_ERROR("Error: bad input file name \'%s\'\n", path);
+	*error = ERROR_INPUT_NAME;
+	return NULL;
 }
 
 /**
-	\brief Writes bytes to a file
+	\brief Writes bytes to a file, exiting the process on failure
 	@param[in] path the path of the file to write to
 	@param[in] content the bytes to write
 	@param[in] count the number of bytes to write
 */
 void writeBytesToFile(const char *path, const uint8_t *content, size_t count) {
+	const int error = storeBytesToFile(path, content, count);
+	if(ERROR_NONE != error) {
+		exit(error);
+	}
+}
+
+/**
+	\brief Writes bytes to a file, reporting failure to the caller
+	@param[in] path the path of the file to write to
+	@param[in] content the bytes to write
+	@param[in] count the number of bytes to write
+	\return ERROR_NONE on success, otherwise one of the ERROR_OUTPUT_* codes
+*/
+int storeBytesToFile(const char *path, const uint8_t *content, size_t count) {
 	// Open the file pointed to by path
 	FILE *file = fopen(path, "w+b");
 	if(file) {
 		// Write the content into the file
-		if(fwrite((void *)content, sizeof(uint8_t), count, file) == count) {
-			fclose(file);
-		}
-		else {
-			fprintf(stderr, "Error: could not write to output file \'%s\'\n", path);
-			exit(ERROR_OUTPUT_WRITE);
+		const bool written = fwrite((void *)content, sizeof(uint8_t), count, file) == count;
+		if(fclose(file) == 0 && written) {
+			return ERROR_NONE;
 		}
+		LOG_ERROR("Error: could not write to output file \'%s\'\n", path);
+		return ERROR_OUTPUT_WRITE;
 	}
 	// Could not open file
-	else {
-		fprintf(stderr, "Error: bad output file name \'%s\'\n", path);
-		exit(ERROR_OUTPUT_NAME);
-	}
+	LOG_ERROR("Error: bad output file name \'%s\'\n", path);
+	return ERROR_OUTPUT_NAME;
 }
 
 /**
@@ -334,13 +598,13 @@ void writeBytesToFile(const char *path, const uint8_t *content, size_t count) {
 	\return whether creation succeeded or not
 */
 bool accountCreate(const char *account) {
-	fprintf(stdout, "Info: attempting to create account with name %s\n", account);
+	LOG_INFO("Info: attempting to create account with name %s\n", account);
 	uint64_t createResult = blakfx_helix_accountCreate(account);
 	if(createResult != 0) {
-		fprintf(stderr, "Warn: helix_accountLocalNew returned exit code: %"PRIu64"\n", createResult);
+		LOG_WARN("Warn: helix_accountLocalNew returned exit code: %"PRIu64"\n", createResult);
 		return false;
 	}
-	fprintf(stdout, "Info: account creation of name %s succeeded\n", account);
+	LOG_INFO("Info: account creation of name %s succeeded\n", account);
 	return true;
 }
 
@@ -350,13 +614,13 @@ bool accountCreate(const char *account) {
 	\return whether account login succeeded or not
 */
 bool accountLogin(const char *account) {
-	fprintf(stdout, "Info: attempting to login to account with name %s\n", account);
+	LOG_INFO("Info: attempting to login to account with name %s\n", account);
 	uint64_t loginResult = blakfx_helix_accountLogin(account);
 	if(loginResult != 0) {
-		fprintf(stderr, "Warn: helix_accountLocalLogin returned exit code: %"PRIu64"\n", loginResult);
+		LOG_WARN("Warn: helix_accountLocalLogin returned exit code: %"PRIu64"\n", loginResult);
 		return false;
 	}
-	fprintf(stdout, "Info: account login of name %s succeeded\n", account);
+	LOG_INFO("Info: account login of name %s succeeded\n", account);
 	return true;
 }
 
@@ -366,13 +630,13 @@ bool accountLogin(const char *account) {
 	\return whether account deletion succeeded or not
 */
 bool accountDelete(const char *account) {
-	fprintf(stdout, "Info: attempting to delete account with name %s\n", account);
+	LOG_INFO("Info: attempting to delete account with name %s\n", account);
 	uint64_t deleteResult = blakfx_helix_accountDelete(account);
 	if(deleteResult != 0) {
-		fprintf(stderr, "Warn: helix_accountLocalDelete returned exit code: %"PRIu64"\n", deleteResult);
+		LOG_WARN("Warn: helix_accountLocalDelete returned exit code: %"PRIu64"\n", deleteResult);
 		return false;
 	}
-	fprintf(stdout, "Info: account deleteion of name %s succeeded\n", account);
+	LOG_INFO("Info: account deleteion of name %s succeeded\n", account);
 	return true;
 }
 
@@ -391,21 +655,21 @@ void loadHelixModule(const char *server_ip, uint16_t server_port, const char *ac
 
 	// Start up the module, either with real or simulated device
 	if(device) {
-		fprintf(stdout, "Info: starting up Helix module with simulated device %s for user %s\n", device, account);
+		LOG_INFO("Info: starting up Helix module with simulated device %s for user %s\n", device, account);
 
 		// Run the advanced startup for the module with this simulated device
 		const invokeStatus_t loadStatus = blakfx_helix_apiStartup_Advanced(server_ip, server_port, (char *)device, 0, NULL);
 		if( INVOKE_STATUS_TRUE != loadStatus) {
-			fprintf(stderr, "Error: helix_apiStartupAdvanced returned exit code: %d\n", loadStatus);
+			LOG_ERROR("Error: helix_apiStartupAdvanced returned exit code: %d\n", loadStatus);
 	    	exit(ERROR_HELIX_MODULE);
 		}
 	}
 	else {
 		// Run with this genuine device
-		fprintf(stdout, "Info: starting up Helix module with real device for user %s\n", account);
+		LOG_INFO("Info: starting up Helix module with real device for user %s\n", account);
 		const invokeStatus_t loadStatus = blakfx_helix_apiStartup(server_ip, server_port, 0);
 		if( INVOKE_STATUS_TRUE != loadStatus) {
-			fprintf(stderr, "Error: helix_apiStartup returned exit code: %d\n", loadStatus);
+			LOG_ERROR("Error: helix_apiStartup returned exit code: %d\n", loadStatus);
 			exit(ERROR_HELIX_MODULE);
 		}
 	}
@@ -481,65 +745,120 @@ int authenticateWithHelixNetwork(const char *account) {
 }
 
 /**
-	\brief Given some plain content, encrypt it for a given target user
-	@param[in] recipientAccount the name of the target to encrypt this message for
-	@param[in] content the content to encrypt
-	@param[in] len the size of the content to encrypt
-	@param[in] password the password to encrypt the content with
-	@param[out] outBytes the number of bytes of the encryption result
-	\return the encrypted bytes result
+	\brief Look up a recipient account on the key-server, exiting the process if it can not be found
+	@param[in] recipientAccount the name of the target to look up
+	\return promise id identifying the found recipient, usable with ::blakfx_helix_encryptStart
 */
-uint8_t * encryptFromBytes(const char *recipientAccount, uint8_t *content, size_t len, const char *password, size_t *outBytes) {
-	fprintf(stdout, "Info: encrypt: Attempting to encrypt %zu bytes with password %s\n", len, password);
-	
-	*outBytes = 0;
-	uint8_t *result = NULL;
+PROMISE_ID findRecipient(const char *recipientAccount) {
 	assert(recipientAccount != NULL);
 	
 	// Attempt to find recipient
 	int64_t msWait = 5000;
 	const PROMISE_ID recipientID = blakfx_helix_simpleSearchForRecipientByName(recipientAccount, msWait);
-	fprintf(stdout, "Info: encrypt: search for user [%s] returned promise: %"PRIu64"\n", recipientAccount, recipientID);
+	LOG_DEBUG("Debug: encrypt: search for user [%s] returned promise: %"PRIu64"\n", recipientAccount, recipientID);
 	const promiseStatusAndFlags_t foundRecipient = blakfx_helix_waitEventStatus(recipientID);
 	if(PROMISE_DATA_AVAILABLE != foundRecipient ) {
-		fprintf(stderr, "Error: encrypt: could not find test account - got code %d\n", foundRecipient);
+		LOG_ERROR("Error: encrypt: could not find test account - got code %d\n", foundRecipient);
 		exit(ERROR_HELIX_ENCRYPT_RECIPIENT);
 	}
-		
-	fprintf(stdout, "Info: encrypt: Attempting to get encryption handle to work on %p, guarded by promise: %"PRIi64"\n", content, recipientID);
+	return recipientID;
+}
+
+/**
+	\brief Given some plain content, encrypt it for a given target user
+	@param[in] recipientAccount the name of the target to encrypt this message for
+	@param[in] content the content to encrypt
+	@param[in] len the size of the content to encrypt
+	@param[in] password the password to encrypt the content with
+	@param[out] outBytes the number of bytes of the encryption result
+	\return the encrypted bytes result
+*/
+uint8_t * encryptFromBytes(const char *recipientAccount, uint8_t *content, size_t len, const char *password, size_t *outBytes) {
+	const PROMISE_ID recipientID = findRecipient(recipientAccount);
+
+	ENCRYPT_ID encryptionHandle = 0;
+	uint8_t *result = encryptForRecipient(recipientID, content, len, password, outBytes, &encryptionHandle);
+	if(!result) {
+		exit(ERROR_HELIX_ENCRYPT_EMPTY);
+	}
+
+	// NOTE: if "blakfx_helix_encryptGetOutputData" used flag "USER_OWNS_MEMORY",
+	// caller MUST take ownership of the memory associated with returned handle_id (encryptionHandle),
+	// and signal to Helix library (by invoking "blakfx_helix_encryptConclude") to 
+	// release internal resources associated with the handle-id (encryptionHandle).
+	// Otherwise, a logical resource leak will occur.
+	//
+	//const invokeStatus_t encCleanUp = blakfx_helix_encryptConclude(encryptionHandle);
+	//fprintf(stdout, "Info: encrypt: Concluded encryption operation with code: %d\n", encCleanUp);
+
+	return result;
+}
+
+/**
+	\brief Given some plain content, encrypt it for an already looked-up recipient
+	@param[in] recipientID the recipient promise returned by ::findRecipient
+	@param[in] content the content to encrypt
+	@param[in] len the size of the content to encrypt
+	@param[in] password the password to encrypt the content with
+	@param[out] outBytes the number of bytes of the encryption result
+	@param[out] handle the encryption handle; pass it to ::blakfx_helix_encryptConclude once the result is no longer used
+	\return the encrypted bytes result (owned by Helix), or NULL on failure
+*/
+uint8_t * encryptForRecipient(PROMISE_ID recipientID, uint8_t *content, size_t len, const char *password, size_t *outBytes, ENCRYPT_ID *handle) {
+	*handle = beginEncryption(recipientID, content, len, password);
+	return completeEncryption(*handle, outBytes);
+}
+
+/**
+	\brief Submit plain content for encryption without waiting for it to complete.
+	Helix encrypts in the background; the caller is free to do other work (ex: file I/O) until ::completeEncryption.
+	@param[in] recipientID the recipient promise returned by ::findRecipient
+	@param[in] content the content to encrypt; Helix copies it (HELIX_OWNS_MEMORY), so the caller may free it once this call returns
+	@param[in] len the size of the content to encrypt
+	@param[in] password the password to encrypt the content with
+	\return the encryption handle
+*/
+ENCRYPT_ID beginEncryption(PROMISE_ID recipientID, uint8_t *content, size_t len, const char *password) {
+	LOG_DEBUG("Debug: encrypt: Attempting to encrypt %zu bytes with password %s\n", len, password);
+	LOG_DEBUG("Debug: encrypt: Attempting to get encryption handle to work on %p, guarded by promise: %"PRIi64"\n", content, recipientID);
 	// Get encryption handle
+	// HELIX takes a copy of the supplied buffer - the caller's one is no longer needed once this returns
 	const uint64_t encryptionHandle = blakfx_helix_encryptStart(recipientID, (void *)content, len, (char *)password, NULL, HELIX_OWNS_MEMORY);
-	fprintf(stdout, "Info: encrypt: Got encryption handle %"PRIu64" for promise: %"PRIi64"\n", encryptionHandle, recipientID);
+	LOG_DEBUG("Debug: encrypt: Got encryption handle %"PRIu64" for promise: %"PRIi64"\n", encryptionHandle, recipientID);
+	return encryptionHandle;
+}
 
-	const promiseStatusAndFlags_t encryptionDone = blakfx_helix_waitEvent(encryptionHandle, PROMISE_INFINITE);
-	fprintf(stdout, "Info: encrypt: Encryption finished, handle: %"PRIu64" returned action code: %d\n", encryptionHandle, encryptionDone);
+/**
+	\brief Wait for a submitted encryption to complete and retrieve its result
+	@param[in] encryptionHandle the handle returned by ::beginEncryption
+	@param[out] outBytes the number of bytes of the encryption result
+	\return the encrypted bytes result (owned by Helix), or NULL on failure
+*/
+uint8_t * completeEncryption(ENCRYPT_ID encryptionHandle, size_t *outBytes) {
+	*outBytes = 0;
+	uint8_t *result = NULL;
+
+	const invokeStatus_t encryptionDone = blakfx_helix_waitEvent(encryptionHandle, PROMISE_INFINITE);
+	LOG_DEBUG("Debug: encrypt: Encryption finished, handle: %"PRIu64" returned action code: %d\n", encryptionHandle, encryptionDone);
 	
 	// Encrypt the data
 	const promiseStatusAndFlags_t foundValidEncryptedData = blakfx_helix_waitEventStatus(encryptionHandle);
-	fprintf(stdout, "Info: encrypt: Starting to retrieve encrypted data after getting validation code: %d\n", foundValidEncryptedData);
+	LOG_DEBUG("Debug: encrypt: Starting to retrieve encrypted data after getting validation code: %d\n", foundValidEncryptedData);
 	if( PROMISE_DATA_AVAILABLE != foundValidEncryptedData ) {
-		fprintf(stderr, "Error: encrypt: encryption completed but returned error code: %d\n", foundValidEncryptedData);
-		exit(ERROR_HELIX_ENCRYPT_EMPTY);
+		LOG_ERROR("Error: encrypt: encryption completed but returned error code: %d\n", foundValidEncryptedData);
+		return NULL;
 	}
 	
 	// HELIX owns returned buffer, it will destroy it, when "encryptConclude" is called with handle_id
 	size_t dataSize = 0;
 	const invokeStatus_t retrievalStatus = blakfx_helix_encryptGetOutputData(encryptionHandle, &result, &dataSize, HELIX_OWNS_MEMORY); //or USER_OWNS_MEMORY
 	if(result && dataSize > 0) {
-		fprintf(stdout, "Info: encrypt: Encryption succeeded - returning blob at %p of length %zu bytes with status %d\n", result, dataSize, retrievalStatus);
+		LOG_DEBUG("Debug: encrypt: Encryption succeeded - returning blob at %p of length %zu bytes with status %d\n", result, dataSize, retrievalStatus);
 		*outBytes = dataSize;
+		return result;
 	}
-	
-	// NOTE: if above call "blakfx_helix_encryptGetOutputData" used flag "USER_OWNS_MEMORY",
-	// caller MUST take ownership of the memory associated with returned handle_id (encryptionHandle),
-	// and signal to Helix library (by invoking "blakfx_helix_encryptConclude") to 
-	// release internal resources associated with the handle-id (encryptionHandle).
-	// Otherwise, a logical resource leak will occur.
-	//
-	//const invokeStatus_t encCleanUp = blakfx_helix_encryptConclude(encryptionHandle);
-	//fprintf(stdout, "Info: encrypt: Concluded encryption operation with code: %d\n", encCleanUp);
-
-	return result;
+	LOG_ERROR("Error: encrypt: no encrypted data returned for handle %"PRIu64", status %d\n", encryptionHandle, retrievalStatus);
+	return NULL;
 }
 
 /**
@@ -551,35 +870,625 @@ uint8_t * encryptFromBytes(const char *recipientAccount, uint8_t *content, size_
 	\return the decrypted bytes result
 */
 uint8_t * decryptFromBytes(uint8_t *blob, size_t len, const char *password, size_t *outBytes) {
-	fprintf(stdout, "Info: decrypt: Attempting to decrypt %zu bytes with password %s\n", len, password);
-	
-	*outBytes = 0;
-	uint8_t *result = NULL;
+	DECRYPT_ID decryptionHandle = 0;
+	uint8_t *result = decryptToBytes(blob, len, password, outBytes, &decryptionHandle);
+	if(!result) {
+		exit(ERROR_HELIX_DECRYPT_STATUS);
+	}
+	return result;
+}
+
+/**
+	\brief Given some encrypted content, decrypt it, reporting failure to the caller
+	@param[in] blob the encrypted content to decrypt; it must remain valid until this call returns
+	@param[in] len the size of the content to decrypt
+	@param[in] password the password to use when decrypting the content
+	@param[out] outBytes the number of bytes of the decryption result
+	@param[out] handle the decryption handle
+	\return the decrypted bytes result (owned by Helix), or NULL on failure
+*/
+uint8_t * decryptToBytes(uint8_t *blob, size_t len, const char *password, size_t *outBytes, DECRYPT_ID *handle) {
+	*handle = beginDecryption(blob, len, password);
+	return completeDecryption(*handle, outBytes);
+}
+
+/**
+	\brief Submit encrypted content for decryption without waiting for it to complete.
+	Helix decrypts in the background; the caller is free to do other work (ex: file I/O) until ::completeDecryption.
+	@param[in] blob the encrypted content to decrypt; it must remain valid until ::completeDecryption returns
+	@param[in] len the size of the content to decrypt
+	@param[in] password the password to use when decrypting the content
+	\return the decryption handle
+*/
+DECRYPT_ID beginDecryption(uint8_t *blob, size_t len, const char *password) {
+	LOG_DEBUG("Debug: decrypt: Attempting to decrypt %zu bytes with password %s\n", len, password);
 	
 	// Get decryption handle
-	fprintf(stdout, "Info: decrypt: Attempting to get decryption handle, for buffer at %p, with byte-size %zu\n", blob, len);
+	LOG_DEBUG("Debug: decrypt: Attempting to get decryption handle, for buffer at %p, with byte-size %zu\n", blob, len);
 	// HELIX will NOT take copy of the supplied buffer - it MUST remain valid until decrypt operation completes
-	const ENCRYPT_ID decryptionHandle = blakfx_helix_decryptStart(blob, len, (char *)password, USER_OWNS_MEMORY);
-	fprintf(stdout, "Info: decrypt: Got decryption handle: %"PRIu64"\n", decryptionHandle);
+	const DECRYPT_ID decryptionHandle = blakfx_helix_decryptStart(blob, len, (char *)password, USER_OWNS_MEMORY);
+	LOG_DEBUG("Debug: decrypt: Got decryption handle: %"PRIu64"\n", decryptionHandle);
+	return decryptionHandle;
+}
+
+/**
+	\brief Wait for a submitted decryption to complete and retrieve its result
+	@param[in] decryptionHandle the handle returned by ::beginDecryption
+	@param[out] outBytes the number of bytes of the decryption result
+	\return the decrypted bytes result (owned by Helix), or NULL on failure
+*/
+uint8_t * completeDecryption(DECRYPT_ID decryptionHandle, size_t *outBytes) {
+	*outBytes = 0;
+	uint8_t *result = NULL;
 
 	const invokeStatus_t decryptionStatus = blakfx_helix_waitEvent(decryptionHandle, PROMISE_INFINITE);
-	fprintf(stdout, "Info: decrypt: Decryption finished: handle %"PRIi64" returned action code %d\n", decryptionHandle, decryptionStatus);
+	LOG_DEBUG("Debug: decrypt: Decryption finished: handle %"PRIi64" returned action code %d\n", decryptionHandle, decryptionStatus);
 
 
 	// Decrypt the data
 	promiseStatusAndFlags_t foundValidDecryptedData = blakfx_helix_waitEventStatus(decryptionHandle);
 	if(PROMISE_DATA_AVAILABLE != foundValidDecryptedData) {
-		fprintf(stderr, "Error: decrypt: could not retrieve decrypted data successfully, code: %d\n", foundValidDecryptedData);
-		exit(ERROR_HELIX_DECRYPT_STATUS);
+		LOG_ERROR("Error: decrypt: could not retrieve decrypted data successfully, code: %d\n", foundValidDecryptedData);
+		return NULL;
 	}
 	
 	size_t dataSize = 0;
 	const invokeStatus_t retrievalStatus = blakfx_helix_decryptGetOutputData(decryptionHandle, &result, &dataSize);
 	if(result && dataSize > 0) {
-		fprintf(stdout, "Info: decrypt: Decryption completed - returning blob at %p of length %zu bytes with status: %d\n", result, dataSize, retrievalStatus);
+		LOG_DEBUG("Debug: decrypt: Decryption completed - returning blob at %p of length %zu bytes with status: %d\n", result, dataSize, retrievalStatus);
 		*outBytes = dataSize;
+		return result;
 	}
-	
-	return result;
+	LOG_ERROR("Error: decrypt: no decrypted data returned for handle %"PRIu64", status %d\n", decryptionHandle, retrievalStatus);
+	return NULL;
+}
+
+
+// BATCH MODE: INPUT COLLECTION, WORKER POOL, THROUGHPUT SUMMARY
+/**
+	\brief Append a copy of an input file path to the batch
+	@param[in,out] job the batch to extend
+	@param[in] path the input file path
+	@param[in] bytes the size of the input file
+	\return ERROR_NONE on success, ERROR_INPUT_MALLOC if the path could not be stored
+*/
+int batchAddPath(batchJob_t *job, const char *path, uint64_t bytes) {
+	if(job->count == job->capacity) {
+		const size_t capacity = (job->capacity) ? job->capacity * 2 : 64;
+		batchInput_t *inputs = (batchInput_t *)realloc(job->inputs, capacity * sizeof(batchInput_t));
+		if(!inputs) {
+			LOG_ERROR("Error: could not allocate memory for batch input list\n");
+			return ERROR_INPUT_MALLOC;
+		}
+		job->inputs = inputs;
+		job->capacity = capacity;
+	}
+
+	const size_t length = strlen(path) + 1;
+	char *copy = (char *)malloc(length);
+	if(!copy) {
+		LOG_ERROR("Error: could not allocate memory for batch input \'%s\'\n", path);
+		return ERROR_INPUT_MALLOC;
+	}
+	memcpy(copy, path, length);
+	job->inputs[job->count].path = copy;
+	job->inputs[job->count].bytes = bytes;
+	job->count++;
+	return ERROR_NONE;
+}
+
+/**
+	\brief Size of a file on disk
+	@param[in] path the path of the file
+	\return the size of the file in bytes, or 0 if it can not be opened
+*/
+uint64_t fileSizeOf(const char *path) {
+	uint64_t bytes = 0;
+	FILE *file = fopen(path, "rb");
+	if(file) {
+		fseek(file, 0, SEEK_END);
+		const long position = ftell(file);
+		bytes = (position > 0) ? (uint64_t)position : 0;
+		fclose(file);
+	}
+	return bytes;
+}
+
+/**
+	\brief Decide whether a file found while walking a directory belongs in the batch.
+	Encryption skips outputs of earlier runs; decryption alone only picks up encrypted files.
+	@param[in] job the batch being collected
+	@param[in] path the candidate file path
+	\return whether the file should be processed
+*/
+bool batchAcceptsPath(const batchJob_t *job, const char *path) {
+	const size_t length = strlen(path);
+	const bool isEncrypted = length >= 10 && 0 == strcmp(path + length - 10, "-encrypted");
+	const bool isDecrypted = length >= 10 && 0 == strcmp(path + length - 10, "-decrypted");
+	if(job->encrypt) {
+		return !isEncrypted && !isDecrypted;
+	}
+	return isEncrypted;
+}
+
+/**
+	\brief Collect input files from a text file listing one path per line (blank lines are ignored)
+	@param[in,out] job the batch to fill
+	@param[in] listPath the path of the list file
+	\return ERROR_NONE on success, otherwise an ERROR_* code
+*/
+int collectFilesFromList(batchJob_t *job, const char *listPath) {
+	FILE *file = fopen(listPath, "r");
+	if(!file) {
+		LOG_ERROR("Error: bad input list file name \'%s\'\n", listPath);
+		return ERROR_BATCH_INPUT;
+	}
+
+	int error = ERROR_NONE;
+	char line[MAX_FILEPATH_LENGTH] = { 0 };
+	while(ERROR_NONE == error && fgets(line, sizeof(line), file)) {
+		size_t length = strlen(line);
+		if(length > 0 && line[length - 1] != '\n' && !feof(file)) {
+			LOG_ERROR("Error: input list \'%s\' holds a path longer than %d characters\n", listPath, MAX_FILEPATH_LENGTH - 1);
+			error = ERROR_BATCH_INPUT;
+			break;
+		}
+		while(length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			line[--length] = '\0';
+		}
+		if(length > 0) {
+			error = batchAddPath(job, line, fileSizeOf(line));
+		}
+	}
+	fclose(file);
+	return error;
+}
+
+/**
+	\brief Collect input files by walking a directory recursively (symbolic links are not followed)
+	@param[in,out] job the batch to fill
+	@param[in] dirPath the directory to walk
+	\return ERROR_NONE on success, otherwise an ERROR_* code
+*/
+int collectFilesFromDirectory(batchJob_t *job, const char *dirPath) {
+#if defined (HELIX_DEMO_POSIX)
+	DIR *directory = opendir(dirPath);
+	if(!directory) {
+		LOG_ERROR("Error: bad input directory name \'%s\'\n", dirPath);
+		return ERROR_BATCH_INPUT;
+	}
+
+	int error = ERROR_NONE;
+	char path[MAX_FILEPATH_LENGTH] = { 0 };
+	struct dirent *entry = NULL;
+	while(ERROR_NONE == error && (entry = readdir(directory)) != NULL) {
+		if(0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+			continue;
+		}
+		if(snprintf(path, sizeof(path), "%s/%s", dirPath, entry->d_name) >= (int)sizeof(path)) {
+			LOG_ERROR("Error: path under \'%s\' is longer than %d characters\n", dirPath, MAX_FILEPATH_LENGTH - 1);
+			error = ERROR_BATCH_INPUT;
+			break;
+		}
+
+		struct stat info;
+		if(0 != lstat(path, &info)) {
+			LOG_WARN("Warn: could not stat \'%s\', skipping it\n", path);
+			continue;
+		}
+		if(S_ISDIR(info.st_mode)) {
+			error = collectFilesFromDirectory(job, path);
+		}
+		else if(S_ISREG(info.st_mode) && batchAcceptsPath(job, path)) {
+			error = batchAddPath(job, path, (uint64_t)info.st_size);
+		}
+	}
+	closedir(directory);
+	return error;
+#else
+	(void)job;
+	LOG_ERROR("Error: --recursive is not supported on this platform, use --list instead (directory \'%s\')\n", dirPath);
+	return ERROR_BATCH_INPUT;
+#endif
+}
+
+/**
+	\brief Round-trip a single batch input (-e -d): encrypt it, decrypt the result back, and write both outputs next to it.
+	Unlike the single-file path, failures are reported to the caller instead of ending the process, and
+	the encryption is concluded as soon as its outputs are written.
+	Decrypted results stay owned by Helix: the shipped library exports no call to release them.
+	@param[in] job the batch settings
+	@param[in] path the input file path
+	@param[in] reserved the input's memory reservation, returned to the budget once its outputs are written
+	@param[out] bytesIn the number of bytes read from the input file
+	@param[out] bytesOut the number of bytes written to output files
+	\return ERROR_NONE on success, otherwise an ERROR_* code
+*/
+int processBatchFile(batchJob_t *job, const char *path, uint64_t reserved, uint64_t *bytesIn, uint64_t *bytesOut) {
+	*bytesIn = 0;
+	*bytesOut = 0;
+
+	char outFileEncrypted[MAX_FILEPATH_LENGTH] = { 0 };
+	char outFileDecrypted[MAX_FILEPATH_LENGTH] = { 0 };
+	if(snprintf(outFileEncrypted, sizeof(outFileEncrypted), "%s-encrypted", path) >= (int)sizeof(outFileEncrypted)
+		|| snprintf(outFileDecrypted, sizeof(outFileDecrypted), "%s-decrypted", path) >= (int)sizeof(outFileDecrypted)) {
+		LOG_ERROR("Error: output file name for \'%s\' is too long\n", path);
+		batchReleaseBudget(job, reserved);
+		return ERROR_OUTPUT_NAME;
+	}
+
+	int error = ERROR_NONE;
+	size_t bytesFromFile = 0;
+	uint8_t *dataFromFile = loadBytesFromFile(path, &bytesFromFile, &error);
+	if(!dataFromFile) {
+		batchReleaseBudget(job, reserved);
+		return error;
+	}
+	*bytesIn = bytesFromFile;
+
+	// Encrypt plaindata and write it out
+	size_t encryptedBytes = 0;
+	ENCRYPT_ID encryptionHandle = 0;
+	uint8_t *encrypted = encryptForRecipient(job->recipientID, dataFromFile, bytesFromFile, job->password, &encryptedBytes, &encryptionHandle);
+	// Helix copied the plaindata (HELIX_OWNS_MEMORY) - drop ours so the input costs no more than its reservation
+	free(dataFromFile);
+	error = (encrypted) ? storeBytesToFile(outFileEncrypted, encrypted, encryptedBytes) : ERROR_HELIX_ENCRYPT_EMPTY;
+	if(ERROR_NONE == error) {
+		*bytesOut += encryptedBytes;
+	}
+
+	// Decrypt the encryption result back, and write it out
+	if(ERROR_NONE == error) {
+		size_t decryptedBytes = 0;
+		DECRYPT_ID decryptionHandle = 0;
+		uint8_t *decrypted = decryptToBytes(encrypted, encryptedBytes, job->password, &decryptedBytes, &decryptionHandle);
+		if(!decrypted) {
+			error = ERROR_HELIX_DECRYPT_STATUS;
+		}
+		else if(decryptedBytes != bytesFromFile) {
+			LOG_ERROR("Error: batch: byte count between original plaindata (%zu) and decrypted plaindata (%zu) of \'%s\' differs\n", bytesFromFile, decryptedBytes, path);
+			error = ERROR_HELIX_DECRYPT_SIZE;
+		}
+		else {
+			error = storeBytesToFile(outFileDecrypted, decrypted, decryptedBytes);
+			if(ERROR_NONE == error) {
+				*bytesOut += decryptedBytes;
+			}
+		}
+	}
+
+	// Encrypted buffer was requested with HELIX_OWNS_MEMORY - conclude only once decryption no longer reads it
+	blakfx_helix_encryptConclude(encryptionHandle);
+	batchReleaseBudget(job, reserved);
+	return error;
+}
+
+/**
+	\brief Record the outcome of one batch input in the shared counters
+	@param[in,out] job the batch being processed
+	@param[in] path the input file path
+	@param[in] error ERROR_NONE on success, otherwise an ERROR_* code
+	@param[in] bytesIn the number of bytes read from the input file
+	@param[in] bytesOut the number of bytes written to output files
+*/
+void batchAccount(batchJob_t *job, const char *path, int error, uint64_t bytesIn, uint64_t bytesOut) {
+	if(ERROR_NONE != error) {
+		LOG_ERROR("Error: batch: processing \'%s\' failed with exit code: %d\n", path, error);
+	}
+
+	BATCH_LOCK(job);
+	job->bytesIn += bytesIn;
+	job->bytesOut += bytesOut;
+	if(ERROR_NONE == error) {
+		job->filesDone++;
+	} else {
+		job->filesFailed++;
+	}
+	BATCH_UNLOCK(job);
+}
+
+/**
+	\brief Round-trip batch worker: takes input files off the shared list until it is exhausted
+	@param[in] context the batch being processed (batchJob_t *)
+	\return always NULL
+*/
+void * batchWorker(void *context) {
+	batchJob_t *job = (batchJob_t *)context;
+	const char *path = NULL;
+	uint64_t reserved = 0;
+	while(BATCH_CLAIM_OK == batchClaimInput(job, true, &path, &reserved)) {
+		uint64_t bytesIn = 0, bytesOut = 0;
+		const int error = processBatchFile(job, path, reserved, &bytesIn, &bytesOut);
+		batchAccount(job, path, error, bytesIn, bytesOut);
+	}
+	return NULL;
+}
+
+/**
+	\brief Claim the next input off the shared list, reserving memory for it from the in-flight budget.
+	An input is always granted when nothing else is in flight, so a single file larger than the budget still
+	gets processed. Workers must not wait while holding reservations of their own.
+	@param[in,out] job the batch being processed
+	@param[in] wait whether to block until the budget allows the next input, or return BATCH_CLAIM_BUSY right away
+	@param[out] path the claimed input file path
+	@param[out] reserved the memory reserved for the claimed input; return it with ::batchReleaseBudget
+	\return outcome of the claim
+*/
+batchClaim_t batchClaimInput(batchJob_t *job, bool wait, const char **path, uint64_t *reserved) {
+	BATCH_LOCK(job);
+	for(;;) {
+		if(job->next >= job->count) {
+			BATCH_UNLOCK(job);
+			return BATCH_CLAIM_NONE;
+		}
+
+		// Two copies of the input are live at once: ours (or Helix's, once encryption took it over) and the similarly sized output
+		const uint64_t cost = 2 * job->inputs[job->next].bytes;
+		if(0 == job->maxInFlightBytes || 0 == job->inFlightBytes || job->inFlightBytes + cost <= job->maxInFlightBytes) {
+			*path = job->inputs[job->next++].path;
+			*reserved = cost;
+			job->inFlightBytes += cost;
+			BATCH_UNLOCK(job);
+			return BATCH_CLAIM_OK;
+		}
+		if(!wait) {
+			job->claimsDeferred++;
+			BATCH_UNLOCK(job);
+			return BATCH_CLAIM_BUSY;
+		}
+		BATCH_WAIT(job);
+	}
+}
+
+/**
+	\brief Return memory reserved by ::batchClaimInput to the in-flight budget, waking up waiting workers
+	@param[in,out] job the batch being processed
+	@param[in] reserved the reservation to return
+*/
+void batchReleaseBudget(batchJob_t *job, uint64_t reserved) {
+	BATCH_LOCK(job);
+	job->inFlightBytes -= reserved;
+	BATCH_SIGNAL(job);
+	BATCH_UNLOCK(job);
+}
+
+/**
+	\brief Claim the next input and read it from disk.
+	Inputs that can not be read are accounted as failed, and the following one is tried instead.
+	@param[in,out] job the batch being processed
+	@param[out] stage receives the read input
+	@param[in] wait whether to block until the in-flight budget allows the next input
+	\return BATCH_CLAIM_OK with stage filled in, or why no input was read
+*/
+batchClaim_t batchReadStage(batchJob_t *job, batchStage_t *stage, bool wait) {
+	for(;;) {
+		memset(stage, 0, sizeof(*stage));
+		const batchClaim_t claim = batchClaimInput(job, wait, &stage->path, &stage->reserved);
+		if(BATCH_CLAIM_OK != claim) {
+			return claim;
+		}
+
+		stage->input = loadBytesFromFile(stage->path, &stage->inputBytes, &stage->error);
+		if(stage->input) {
+			return BATCH_CLAIM_OK;
+		}
+		batchReleaseBudget(job, stage->reserved);
+		batchAccount(job, stage->path, stage->error, 0, 0);
+	}
+}
+
+/**
+	\brief Hand a read input to Helix; the operation proceeds in the background
+	@param[in] job the batch settings
+	@param[in,out] stage the input to submit
+*/
+void batchSubmitStage(batchJob_t *job, batchStage_t *stage) {
+	if(job->encrypt) {
+		stage->handle = beginEncryption(job->recipientID, stage->input, stage->inputBytes, job->password);
+		// Helix copied the plaindata (HELIX_OWNS_MEMORY); decryption reads ours (USER_OWNS_MEMORY) until it completes
+		free(stage->input);
+		stage->input = NULL;
+	} else {
+		stage->handle = beginDecryption(stage->input, stage->inputBytes, job->password);
+	}
+	stage->submitted = true;
+}
+
+/**
+	\brief Wait for the Helix operation of a submitted input to complete
+	@param[in] job the batch settings
+	@param[in,out] stage the submitted input
+*/
+void batchCompleteStage(batchJob_t *job, batchStage_t *stage) {
+	stage->output = (job->encrypt) ? completeEncryption(stage->handle, &stage->outputBytes)
+					: completeDecryption(stage->handle, &stage->outputBytes);
+	if(!stage->output) {
+		stage->error = (job->encrypt) ? ERROR_HELIX_ENCRYPT_EMPTY : ERROR_HELIX_DECRYPT_STATUS;
+	}
+}
+
+/**
+	\brief Write a completed input out, conclude its encryption, release its buffers, and account for it
+	@param[in,out] job the batch being processed
+	@param[in,out] stage the completed input
+*/
+void batchWriteStage(batchJob_t *job, batchStage_t *stage) {
+	uint64_t bytesOut = 0;
+	if(ERROR_NONE == stage->error) {
+		char outFile[MAX_FILEPATH_LENGTH] = { 0 };
+		if(snprintf(outFile, sizeof(outFile), "%s%s", stage->path, (job->encrypt) ? "-encrypted" : "-decrypted") >= (int)sizeof(outFile)) {
+			LOG_ERROR("Error: output file name for \'%s\' is too long\n", stage->path);
+			stage->error = ERROR_OUTPUT_NAME;
+		}
+		else {
+			stage->error = storeBytesToFile(outFile, stage->output, stage->outputBytes);
+			bytesOut = (ERROR_NONE == stage->error) ? stage->outputBytes : 0;
+		}
+	}
+
+	free(stage->input);
+	if(stage->submitted && job->encrypt) {
+		blakfx_helix_encryptConclude(stage->handle);
+	}
+	batchReleaseBudget(job, stage->reserved);
+	batchAccount(job, stage->path, stage->error, stage->inputBytes, bytesOut);
+	memset(stage, 0, sizeof(*stage));
 }
 
+/**
+	\brief Pipelined batch worker, used when either encrypting or decrypting (but not both).
+	While Helix works on input N in the background, this worker writes out the result of input N-1
+	and reads input N+1 from disk, so disk and cipher work overlap instead of adding up.
+	Each worker holds at most three inputs in memory at a time. Reading ahead only happens when the in-flight
+	budget allows it immediately; otherwise the worker first finishes its own input, then waits for budget.
+	@param[in] context the batch being processed (batchJob_t *)
+	\return always NULL
+*/
+void * batchPipelineWorker(void *context) {
+	batchJob_t *job = (batchJob_t *)context;
+	batchStage_t next, current, done;
+	memset(&done, 0, sizeof(done));
+
+	bool haveNext = BATCH_CLAIM_OK == batchReadStage(job, &next, true);
+	bool haveDone = false;
+	while(haveNext) {
+		current = next;
+		batchSubmitStage(job, &current);
+
+		// Overlapped with Helix processing of the current input
+		if(haveDone) {
+			batchWriteStage(job, &done);
+			haveDone = false;
+		}
+		batchClaim_t claim = batchReadStage(job, &next, false);
+
+		batchCompleteStage(job, &current);
+		done = current;
+		haveDone = true;
+		if(BATCH_CLAIM_BUSY == claim) {
+			// Budget exhausted: release own reservation before waiting, so waiting workers never hold any
+			batchWriteStage(job, &done);
+			haveDone = false;
+			claim = batchReadStage(job, &next, true);
+		}
+		haveNext = BATCH_CLAIM_OK == claim;
+	}
+	if(haveDone) {
+		batchWriteStage(job, &done);
+	}
+	return NULL;
+}
+
+/**
+	\brief Process all collected batch inputs with a bounded pool of workers and print a throughput summary
+	@param[in,out] job the batch to process
+	@param[in] jobs the maximum number of files processed concurrently
+	\return ERROR_NONE if every file succeeded, ERROR_BATCH_FAILED otherwise
+*/
+int runBatch(batchJob_t *job, unsigned jobs) {
+	if(0 == job->count) {
+		LOG_INFO("Info: batch: no input files to process\n");
+		return ERROR_NONE;
+	}
+	if(jobs > job->count) {
+		jobs = (unsigned)job->count;
+	}
+#if !defined (HELIX_DEMO_POSIX)
+	// No worker threads without POSIX: the calling thread processes every file
+	jobs = 1;
+#endif
+	// Round-trips (encrypt then decrypt) depend on their own intermediate result and are not pipelined
+	void * (*worker)(void *) = (job->encrypt && job->decrypt) ? batchWorker : batchPipelineWorker;
+	LOG_INFO("Info: batch: processing %zu files with %u %sworkers\n", job->count, jobs, (worker == batchPipelineWorker) ? "pipelined " : "");
+	const double startedAt = monotonicSeconds();
+
+#if defined (HELIX_DEMO_POSIX)
+	pthread_t workers[MAX_BATCH_JOBS];
+	unsigned spawned = 0;
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->budgetFreed, NULL);
+	for(; spawned < jobs; ++spawned) {
+		if(0 != pthread_create(&workers[spawned], NULL, worker, job)) {
+			LOG_WARN("Warn: batch: could only start %u of %u workers\n", spawned, jobs);
+			break;
+		}
+	}
+	if(0 == spawned) {
+		worker(job);
+	}
+	for(unsigned i = 0; i < spawned; ++i) {
+		pthread_join(workers[i], NULL);
+	}
+	pthread_cond_destroy(&job->budgetFreed);
+	pthread_mutex_destroy(&job->lock);
+#else
+	worker(job);
+#endif
+
+	const double elapsed = monotonicSeconds() - startedAt;
+	LOG_INFO("Info: batch: %zu files succeeded, %zu failed, in %.3f s\n", job->filesDone, job->filesFailed, elapsed);
+	if(elapsed > 0.0) {
+		LOG_INFO("Info: batch: read %"PRIu64" bytes, wrote %"PRIu64" bytes - %.2f MiB/s in, %.1f files/s\n", 
+			job->bytesIn, job->bytesOut, (double)job->bytesIn / (1024.0 * 1024.0) / elapsed, (double)(job->filesDone + job->filesFailed) / elapsed);
+	} else {
+		// Too fast for the clock to tell - a rate would be meaningless
+		LOG_INFO("Info: batch: read %"PRIu64" bytes, wrote %"PRIu64" bytes\n", job->bytesIn, job->bytesOut);
+	}
+	if(job->maxInFlightBytes) {
+		LOG_INFO("Info: batch: in-flight limit of %"PRIu64" bytes deferred %zu read-aheads%s\n", job->maxInFlightBytes, job->claimsDeferred,
+			(job->decrypt) ? "; decrypted results stay held by Helix outside this limit" : "");
+	}
+	return (job->filesFailed) ? ERROR_BATCH_FAILED : ERROR_NONE;
+}
+
+/**
+	\brief Release input paths held by a batch
+	@param[in,out] job the batch to release
+*/
+void releaseBatch(batchJob_t *job) {
+	for(size_t i = 0; i < job->count; ++i) {
+		free(job->inputs[i].path);
+	}
+	free(job->inputs);
+	job->inputs = NULL;
+	job->count = job->capacity = job->next = 0;
+}
+
+/**
+	\brief Wall-clock seconds from an arbitrary fixed point, for throughput measurement
+	\return seconds elapsed
+*/
+double monotonicSeconds(void) {
+#if defined (HELIX_DEMO_POSIX)
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#else
+	// The Windows CRT's clock() counts wall time since process start, in milliseconds
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+	\brief Map a --log-level name to the corresponding rank of the utility's own messages
+	@param[in] name one of none, error, warn, info, debug, all
+	@param[out] rank the log rank
+	\return whether name was recognised
+*/
+bool parseLogLevel(const char *name, demoLogRank_t *rank) {
+	static const struct { const char *name; demoLogRank_t rank; } ranks[] = {
+		{ "none",  DEMO_LOG_NONE },
+		{ "error", DEMO_LOG_ERROR },
+		{ "warn",  DEMO_LOG_WARN },
+		{ "info",  DEMO_LOG_INFO },
+		{ "debug", DEMO_LOG_DEBUG },
+		{ "all",   DEMO_LOG_DEBUG },
+	};
+	for(size_t i = 0; i < sizeof(ranks) / sizeof(ranks[0]); ++i) {
+		if(0 == strcmp(name, ranks[i].name)) {
+			*rank = ranks[i].rank;
+			return true;
+		}
+	}
+	return false;
+}